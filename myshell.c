@@ -17,6 +17,7 @@ Requirements (Refer to the document for accuracy and details):
 */
 
 #define _XOPEN_SOURCE 700 // This is for POSIX functions like realpath()
+#define _GNU_SOURCE // This is for Linux interfaces like inotify and syscall()
 
 // Libraries
 #include <stdio.h>
@@ -28,15 +29,1298 @@ Requirements (Refer to the document for accuracy and details):
 #include <string.h>
 #include <dirent.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #define MAX_LINE 1024 // Maximum length of input
 
 //Other functions needed ...
 
+// ---------- JOB PLACEMENT (CPU AFFINITY, NICE, CGROUP LIMITS) ----------
+
+#define MAX_JOBS 64 // Placed background jobs tracked until they finish
+
+// Where and how a job runs, set with "on" or "bgplace"
+struct placement {
+    int has_cpus;              // 1 if an affinity mask was given
+    cpu_set_t cpus;            // CPUs the job may run on
+    int has_nice;              // 1 if a nice value was given
+    int nice;                  // Nice value for the job
+    unsigned long long mem;    // memory.max in bytes (0 --> no limit)
+    int cpu_pct;               // cpu.max as a percentage of one CPU (0 --> no limit)
+};
+
+// A placed job that is still running in the background
+struct job {
+    pid_t pid;                 // Process id (0 --> free slot)
+    char cgroup[PATH_MAX];     // cgroup leaf holding the job ("" --> none)
+};
+
+static struct placement default_place; // Placement for background jobs (and every command in batch mode)
+static int default_place_set = 0;      // 1 if bgplace has set a default placement
+static int batch_mode = 0;             // 1 if commands come from a batch file
+static struct job jobs[MAX_JOBS];      // Placed background jobs
+static char cgroup_base[PATH_MAX];     // The cgroup v2 directory the shell started in
+static char cgroup_group[PATH_MAX];    // myshell-<pid> below it, holding the shell's leaf and one leaf per job
+static int cgroup_memory = 0;          // 1 if job leaves get the memory controller
+static int cgroup_cpu = 0;             // 1 if job leaves get the cpu controller
+static int cgroup_base_memory = 0;     // 1 if the shell enabled the memory controller on cgroup_base
+static int cgroup_base_cpu = 0;        // 1 if the shell enabled the cpu controller on cgroup_base
+static int cgroup_state = -1;          // -1 --> not checked yet, 0 --> unavailable, 1 --> available
+static pid_t cgroup_owner = 0;         // The shell process that set up the cgroups (forked children skip cleanup)
+static unsigned job_seq = 0;           // Counter used to name cgroup leaves
+
+// Parse a CPU list such as "0-7,12" into a CPU set
+static int parse_cpus(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s != '\0') {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        long hi = lo;
+        if (end == s || lo < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo) {
+                return -1;
+            }
+        }
+        if (hi >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        s = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// Parse a size such as "512M" or "2G" into bytes
+static int parse_size(const char *s, unsigned long long *bytes) {
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s || errno != 0 || s[0] == '-') {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    case 'T': case 't': shift = 40; end++; break;
+    }
+    if (*end != '\0' || n == 0 || n > (ULLONG_MAX >> shift)) {
+        return -1;
+    }
+    *bytes = n << shift;
+    return 0;
+}
+
+// Parse one key=value placement option; returns 1 if parsed, 0 if tok is not an option, -1 if invalid
+static int parse_placement_option(const char *who, const char *tok, struct placement *pl) {
+    const char *val = strchr(tok, '=');
+    if (val == NULL) {
+        return 0;
+    }
+    val++;
+
+    if (strncmp(tok, "cpus=", 5) == 0) {
+        if (parse_cpus(val, &pl->cpus) != 0) {
+            fprintf(stderr, "%s: invalid cpu list: %s\n", who, val);
+            return -1;
+        }
+        pl->has_cpus = 1;
+    } else if (strncmp(tok, "nice=", 5) == 0) {
+        char *end;
+        long n = strtol(val, &end, 10);
+        if (end == val || *end != '\0' || n < -20 || n > 19) {
+            fprintf(stderr, "%s: invalid nice value: %s\n", who, val);
+            return -1;
+        }
+        pl->has_nice = 1;
+        pl->nice = (int)n;
+    } else if (strncmp(tok, "mem=", 4) == 0) {
+        if (parse_size(val, &pl->mem) != 0) {
+            fprintf(stderr, "%s: invalid memory size: %s\n", who, val);
+            return -1;
+        }
+    } else if (strncmp(tok, "cpu=", 4) == 0) {
+        char *end;
+        long n = strtol(val, &end, 10);
+        if (end == val || *end != '\0' || n < 1 || n > 100 * CPU_SETSIZE) {
+            fprintf(stderr, "%s: invalid cpu percentage: %s\n", who, val);
+            return -1;
+        }
+        pl->cpu_pct = (int)n;
+    } else {
+        return 0; // Not a placement option, e.g. an argument like "a=b"
+    }
+    return 1;
+}
+
+// Print a placement as the options that would recreate it
+static void print_placement(const struct placement *pl) {
+    const char *sep = ""; // Separator before the next option
+
+    if (pl->has_cpus) {
+        // Print runs of consecutive CPUs as ranges
+        printf("cpus=");
+        const char *comma = "";
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &pl->cpus)) {
+                continue;
+            }
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &pl->cpus)) {
+                last++;
+            }
+            if (last == cpu) {
+                printf("%s%d", comma, cpu);
+            } else {
+                printf("%s%d-%d", comma, cpu, last);
+            }
+            comma = ",";
+            cpu = last;
+        }
+        sep = " ";
+    }
+    if (pl->has_nice) {
+        printf("%snice=%d", sep, pl->nice);
+        sep = " ";
+    }
+    if (pl->mem != 0) {
+        // Use the largest unit that divides the size exactly
+        const char *units = "KMGT";
+        int u = 0;
+        unsigned long long n = pl->mem;
+        while (n % 1024 == 0 && u < 4) {
+            n /= 1024;
+            u++;
+        }
+        if (u == 0) {
+            printf("%smem=%llu", sep, n);
+        } else {
+            printf("%smem=%llu%c", sep, n, units[u - 1]);
+        }
+        sep = " ";
+    }
+    if (pl->cpu_pct != 0) {
+        printf("%scpu=%d", sep, pl->cpu_pct);
+    }
+    printf("\n");
+}
+
+// Write a value to a file inside a cgroup directory
+static int write_cgroup_file(const char *cgroup, const char *file, const char *value) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", cgroup, file) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t len = (ssize_t)strlen(value);
+    int ret = write(fd, value, len) == len ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+// Check whether a controller is listed in a cgroup's cgroup.controllers or cgroup.subtree_control
+static int cgroup_has_controller(const char *cgroup, const char *file, const char *controller) {
+    char path[PATH_MAX];
+    char line[256];
+    int found = 0;
+
+    if (snprintf(path, sizeof(path), "%s/%s", cgroup, file) >= (int)sizeof(path)) {
+        return 0;
+    }
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    if (fgets(line, sizeof(line), f)) {
+        // The file is one line of space separated controller names
+        for (char *name = strtok(line, " \n"); name != NULL && !found; name = strtok(NULL, " \n")) {
+            found = strcmp(name, controller) == 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Enable a controller for the children of a cgroup; returns 1 if it is enabled afterwards
+static int enable_controller(const char *cgroup, const char *controller) {
+    char value[32];
+    snprintf(value, sizeof(value), "+%s", controller);
+    return write_cgroup_file(cgroup, "cgroup.subtree_control", value) == 0 ||
+           cgroup_has_controller(cgroup, "cgroup.subtree_control", controller);
+}
+
+// Put the shell back where it started and remove its cgroups, as far as possible, when it exits
+static void cgroup_cleanup(void) {
+    char path[PATH_MAX];
+
+    // atexit handlers also run in forked children that fail before exec, which must not touch the cgroups
+    if (getpid() != cgroup_owner) {
+        return;
+    }
+
+    // Placed background jobs that outlive the shell keep their group and limits; only the shell moves out.
+    // The next myshell started in the same cgroup removes the group once those jobs have finished.
+    int running = 0;
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].pid == 0) {
+            continue;
+        }
+        if (waitpid(jobs[i].pid, NULL, WNOHANG) == 0) {
+            running = 1;
+        } else if (jobs[i].cgroup[0] != '\0') {
+            rmdir(jobs[i].cgroup); // Finished but never reaped
+        }
+    }
+    if (running) {
+        write_cgroup_file(cgroup_base, "cgroup.procs", "0");
+        if (snprintf(path, sizeof(path), "%s/shell", cgroup_group) < (int)sizeof(path)) {
+            rmdir(path);
+        }
+        return;
+    }
+
+    // Controllers are disabled again bottom up, so the start cgroup may hold processes again
+    for (int i = 0; i < 2; i++) {
+        const char *disable = i == 0 ? "-memory" : "-cpu";
+        int enabled_by_us = i == 0 ? cgroup_base_memory : cgroup_base_cpu;
+        write_cgroup_file(cgroup_group, "cgroup.subtree_control", disable);
+        if (enabled_by_us) {
+            write_cgroup_file(cgroup_base, "cgroup.subtree_control", disable);
+        }
+    }
+    write_cgroup_file(cgroup_base, "cgroup.procs", "0");
+    if (snprintf(path, sizeof(path), "%s/shell", cgroup_group) < (int)sizeof(path)) {
+        rmdir(path);
+    }
+    rmdir(cgroup_group); // Fails harmlessly while background jobs are still running in it
+}
+
+// Remove groups left behind by earlier shells whose placed jobs outlived them, once they are empty
+static void sweep_stale_groups(void) {
+    char path[PATH_MAX];
+    DIR *dir = opendir(cgroup_base);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid;
+        char end;
+        // Only groups named myshell-<pid> whose shell is gone
+        if (sscanf(entry->d_name, "myshell-%d%c", &pid, &end) != 1 || pid == (int)getpid() ||
+            kill(pid, 0) == 0 || errno != ESRCH) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", cgroup_base, entry->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        // rmdir only succeeds on cgroups without processes, so leaves of jobs still running are kept
+        DIR *group = opendir(path);
+        if (group != NULL) {
+            struct dirent *leaf;
+            char leaf_path[PATH_MAX + NAME_MAX + 2];
+            while ((leaf = readdir(group)) != NULL) {
+                if (leaf->d_type == DT_DIR && leaf->d_name[0] != '.') {
+                    snprintf(leaf_path, sizeof(leaf_path), "%s/%s", path, leaf->d_name);
+                    rmdir(leaf_path);
+                }
+            }
+            closedir(group);
+        }
+        rmdir(path);
+    }
+    closedir(dir);
+}
+
+// Set up the shell's cgroups, once: myshell-<pid>/shell holds the shell and myshell-<pid>/job-<n> each job
+static int cgroup_available(void) {
+    char shell_leaf[PATH_MAX];
+
+    if (cgroup_state != -1) {
+        return cgroup_state;
+    }
+    cgroup_state = 0;
+
+    // cgroup v2 is mounted at /sys/fs/cgroup, or at /sys/fs/cgroup/unified on hybrid systems
+    const char *mount = NULL;
+    if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0) {
+        mount = "/sys/fs/cgroup";
+    } else if (access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0) {
+        mount = "/sys/fs/cgroup/unified";
+    }
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (mount == NULL || f == NULL) {
+        if (f != NULL) {
+            fclose(f);
+        }
+        return 0;
+    }
+
+    // The cgroup v2 entry is the line starting with "0::"
+    char line[PATH_MAX];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            const char *rel = strcmp(line + 3, "/") == 0 ? "" : line + 3;
+            found = snprintf(cgroup_base, sizeof(cgroup_base), "%s%s", mount, rel) < (int)sizeof(cgroup_base);
+        }
+    }
+    fclose(f);
+    if (!found || access(cgroup_base, W_OK) != 0 ||
+        snprintf(cgroup_group, sizeof(cgroup_group), "%s/myshell-%d", cgroup_base, (int)getpid()) >=
+            (int)sizeof(cgroup_group) ||
+        snprintf(shell_leaf, sizeof(shell_leaf), "%s/shell", cgroup_group) >= (int)sizeof(shell_leaf)) {
+        return 0;
+    }
+
+    // cgroup v2 only enables controllers on cgroups without processes of their own (except the root),
+    // so the shell moves into a leaf of its own next to the job leaves
+    if ((mkdir(cgroup_group, 0755) != 0 && errno != EEXIST) || (mkdir(shell_leaf, 0755) != 0 && errno != EEXIST)) {
+        rmdir(cgroup_group);
+        return 0;
+    }
+    if (write_cgroup_file(shell_leaf, "cgroup.procs", "0") != 0) {
+        rmdir(shell_leaf);
+        rmdir(cgroup_group);
+        return 0;
+    }
+    cgroup_state = 1;
+    cgroup_owner = getpid();
+    atexit(cgroup_cleanup);
+    sweep_stale_groups();
+
+    // The controllers must be enabled on the start cgroup first; this only works if nothing else runs there
+    if (cgroup_has_controller(cgroup_base, "cgroup.controllers", "memory") &&
+        !cgroup_has_controller(cgroup_base, "cgroup.subtree_control", "memory")) {
+        cgroup_base_memory = enable_controller(cgroup_base, "memory");
+    }
+    if (cgroup_has_controller(cgroup_base, "cgroup.controllers", "cpu") &&
+        !cgroup_has_controller(cgroup_base, "cgroup.subtree_control", "cpu")) {
+        cgroup_base_cpu = enable_controller(cgroup_base, "cpu");
+    }
+    cgroup_memory = cgroup_has_controller(cgroup_group, "cgroup.controllers", "memory") &&
+                    enable_controller(cgroup_group, "memory");
+    cgroup_cpu = cgroup_has_controller(cgroup_group, "cgroup.controllers", "cpu") &&
+                 enable_controller(cgroup_group, "cpu");
+    return 1;
+}
+
+// Read a counter from a cgroup file; key selects a "key value" line, NULL reads the whole file as one number
+static int read_cgroup_value(const char *cgroup, const char *file, const char *key, unsigned long long *value) {
+    char path[PATH_MAX];
+    char line[256];
+    int found = -1;
+
+    if (snprintf(path, sizeof(path), "%s/%s", cgroup, file) >= (int)sizeof(path)) {
+        return -1;
+    }
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    size_t keylen = key != NULL ? strlen(key) : 0;
+    while (found != 0 && fgets(line, sizeof(line), f)) {
+        if (key == NULL) {
+            found = sscanf(line, "%llu", value) == 1 ? 0 : -1;
+            break;
+        }
+        if (strncmp(line, key, keylen) == 0 && line[keylen] == ' ') {
+            found = sscanf(line + keylen + 1, "%llu", value) == 1 ? 0 : -1;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Create a cgroup leaf for a job and apply its limits; leaves cgroup empty if there is no cgroup to use
+static void prepare_job_cgroup(const char *who, const struct placement *pl, char *cgroup, size_t size) {
+    int limits = pl->mem != 0 || pl->cpu_pct != 0;
+    char value[64];
+
+    cgroup[0] = '\0';
+    if (!cgroup_available() ||
+        snprintf(cgroup, size, "%s/job-%u", cgroup_group, job_seq++) >= (int)size ||
+        mkdir(cgroup, 0755) != 0) {
+        cgroup[0] = '\0';
+        if (limits) {
+            fprintf(stderr, "%s: no writable cgroup v2, memory/cpu limits not applied\n", who);
+        }
+        return;
+    }
+
+    if (pl->mem != 0) {
+        snprintf(value, sizeof(value), "%llu", pl->mem);
+        if (!cgroup_memory) {
+            fprintf(stderr, "%s: memory controller not available, memory limit not applied\n", who);
+        } else if (write_cgroup_file(cgroup, "memory.max", value) != 0) {
+            fprintf(stderr, "%s: memory limit not applied: %s\n", who, strerror(errno));
+        }
+    }
+    if (pl->cpu_pct != 0) {
+        snprintf(value, sizeof(value), "%d 100000", pl->cpu_pct * 1000);
+        if (!cgroup_cpu) {
+            fprintf(stderr, "%s: cpu controller not available, cpu limit not applied\n", who);
+        } else if (write_cgroup_file(cgroup, "cpu.max", value) != 0) {
+            fprintf(stderr, "%s: cpu limit not applied: %s\n", who, strerror(errno));
+        }
+    }
+}
+
+// In the child: join the job's cgroup, report the outcome on sync_fd, then set affinity and priority
+static void apply_placement(const char *who, const struct placement *pl, const char *cgroup, int sync_fd) {
+    if (sync_fd != -1) {
+        char joined = write_cgroup_file(cgroup, "cgroup.procs", "0") == 0 ? '1' : '0';
+        if (write(sync_fd, &joined, 1) != 1) {
+            fprintf(stderr, "%s: cgroup: %s\n", who, strerror(errno));
+        }
+        close(sync_fd);
+    }
+    // Affinity and priority failures (e.g. raising priority without root) are reported but not fatal
+    if (pl->has_cpus && sched_setaffinity(0, sizeof(pl->cpus), &pl->cpus) != 0) {
+        fprintf(stderr, "%s: cpus: %s\n", who, strerror(errno));
+    }
+    if (pl->has_nice && setpriority(PRIO_PROCESS, 0, pl->nice) != 0) {
+        fprintf(stderr, "%s: nice: %s\n", who, strerror(errno));
+    }
+}
+
+// Report a finished job's usage on stderr, from its cgroup where possible, and remove the cgroup
+static void finish_job(pid_t pid, const char *cgroup, const struct rusage *ru) {
+    unsigned long long usec = 0;
+    unsigned long long peak = 0;
+    int cpu_from_cgroup = cgroup[0] != '\0' && read_cgroup_value(cgroup, "cpu.stat", "usage_usec", &usec) == 0;
+    // memory.peak needs the memory controller, otherwise use the child's maximum resident set size
+    int mem_from_cgroup = cgroup[0] != '\0' && read_cgroup_value(cgroup, "memory.peak", NULL, &peak) == 0;
+
+    if (!cpu_from_cgroup) {
+        usec = (unsigned long long)(ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000ULL +
+               (unsigned long long)(ru->ru_utime.tv_usec + ru->ru_stime.tv_usec);
+    }
+    if (!mem_from_cgroup) {
+        peak = (unsigned long long)ru->ru_maxrss * 1024ULL;
+    }
+    fprintf(stderr, "[job %d done: cpu %.3f ms (%s), peak mem %.1f MiB (%s)]\n", (int)pid, usec / 1000.0,
+            cpu_from_cgroup ? "cgroup" : "rusage", peak / (1024.0 * 1024.0), mem_from_cgroup ? "cgroup" : "rusage");
+
+    if (cgroup[0] != '\0') {
+        rmdir(cgroup); // Fails harmlessly if the job left processes behind
+    }
+}
+
 // Reaping zombie processes from background execution
 static void reap_zombies(void) {
-    while (waitpid(-1, NULL, WNOHANG) > 0) { // Loop to clean up any child processes that haven't exited
+    pid_t pid;
+    struct rusage ru;
+    while ((pid = wait4(-1, NULL, WNOHANG, &ru)) > 0) { // Loop to clean up any child processes that haven't exited
+        // Report placed background jobs as they finish
+        for (int i = 0; i < MAX_JOBS; i++) {
+            if (jobs[i].pid == pid) {
+                finish_job(pid, jobs[i].cgroup, &ru);
+                jobs[i].pid = 0;
+            }
+        }
+    }
+}
+
+// ---------- LINE EDITING AND TAB COMPLETION ----------
+
+#define MAX_PATH_DIRS 63       // PATH directories tracked by the command trie (one source bit each)
+#define BUILTIN_SOURCE 63      // Source bit used for the shell's internal commands
+#define DENTS_BUF_SIZE 8192    // Buffer size for each getdents64 call
+#define MAX_DIR_CACHE 32       // Directory listings kept for path completion
+#define ESC_TIMEOUT_MS 50      // Time to wait for the rest of an escape sequence
+
+// Loading state of a PATH directory
+#define PATH_PENDING 0         // Not loaded yet, or must be loaded again
+#define PATH_LOADING 1         // Being loaded, one getdents64 batch per idle step
+#define PATH_LOADED 2          // Loaded, and kept up to date by inotify
+
+// Internal commands offered by command completion
+static const char *builtin_names[] = {
+    "cd", "clr", "dir", "environ", "echo", "help", "pause", "quit", "on", "bgplace", NULL
+};
+
+// Layout of the records returned by the getdents64 system call
+struct linux_dirent64 {
+    uint64_t d_ino;            // Inode number
+    int64_t d_off;             // Offset to the next record
+    unsigned short d_reclen;   // Length of this record
+    unsigned char d_type;      // File type (DT_DIR, DT_REG, ...)
+    char d_name[];             // Null-terminated file name
+};
+
+// One node of the command trie; siblings are kept sorted so completions come out in order
+struct trie_node {
+    unsigned char ch;          // Character on the edge leading to this node
+    uint64_t sources;          // Bitmask of PATH directories (and builtins) providing the name ending here
+    struct trie_node *child;   // First child
+    struct trie_node *next;    // Next sibling
+};
+
+// Cached listing of one directory for path completion
+struct dir_cache {
+    char *path;                // Directory as typed by the user ("." for the current directory)
+    dev_t dev;                 // Device, inode and mtime used to detect a stale listing
+    ino_t ino;
+    struct timespec mtime;
+    char **names;              // Entry names
+    unsigned char *is_dir;     // 1 if the matching entry is a directory
+    int count;                 // Number of entries
+    int cap;                   // Allocated entries
+    struct dir_cache *next;    // Next cached directory
+};
+
+// A growable list of completion candidates
+struct completions {
+    char **items;
+    int count;
+    int cap;
+};
+
+static struct trie_node cmd_trie;              // Root of the command trie
+static char *path_dirs[MAX_PATH_DIRS];         // Directories from $PATH
+static int path_watch[MAX_PATH_DIRS];          // inotify watch descriptor for each PATH directory
+static int npath_dirs = 0;                     // Number of PATH directories
+static int path_state[MAX_PATH_DIRS];          // PATH_PENDING, PATH_LOADING or PATH_LOADED
+static int path_fd[MAX_PATH_DIRS];             // Open directory while it is being loaded
+static int path_retry[MAX_PATH_DIRS];          // 1 if the directory could not be watched (e.g. missing)
+static int inotify_fd = -1;                    // inotify instance watching the PATH directories
+static struct dir_cache *dir_cache_head = NULL; // Cached directory listings, most recently used first
+static struct termios orig_termios;            // Terminal settings restored after editing a line
+
+// Read one batch of entries from an open directory with getdents64 and pass them to fn; returns 0 at the end
+static int read_dirent_batch(int fd, void (*fn)(int, const char *, unsigned char, void *), void *ctx) {
+    char buf[DENTS_BUF_SIZE];
+    long nread = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+
+    for (long off = 0; off < nread;) {
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+        fn(fd, d->d_name, d->d_type, ctx);
+        off += d->d_reclen; // Move to the next record
     }
+    return nread > 0;
+}
+
+// Read every entry of an open directory and pass it to fn
+static void for_each_dirent(int fd, void (*fn)(int, const char *, unsigned char, void *), void *ctx) {
+    while (read_dirent_batch(fd, fn, ctx)) {
+        // Keep reading batches of records until the directory is exhausted
+    }
+}
+
+// Set or clear one source bit on the trie entry for name; cleared names free the nodes no longer needed
+static void trie_update(const char *name, int source, int present) {
+    struct trie_node **links[NAME_MAX + 1]; // Link to each node on the path, for pruning
+    struct trie_node *node = &cmd_trie;
+    int depth = 0;
+
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0' && depth <= NAME_MAX; p++) {
+        // Find the child for this character, or the place to insert it in sorted order
+        struct trie_node **link = &node->child;
+        while (*link != NULL && (*link)->ch < *p) {
+            link = &(*link)->next;
+        }
+        if (*link == NULL || (*link)->ch != *p) {
+            if (!present) {
+                return; // Nothing to clear
+            }
+            struct trie_node *n = calloc(1, sizeof(*n));
+            if (n == NULL) {
+                return; // Out of memory, the name is simply not completed
+            }
+            n->ch = *p;
+            n->next = *link;
+            *link = n;
+        }
+        links[depth++] = link;
+        node = *link;
+    }
+
+    if (present) {
+        node->sources |= (uint64_t)1 << source;
+        return;
+    }
+    node->sources &= ~((uint64_t)1 << source);
+
+    // Free the nodes at the end of the path that no longer lead to any name
+    while (depth > 0) {
+        struct trie_node **link = links[--depth];
+        node = *link;
+        if (node->sources != 0 || node->child != NULL) {
+            break;
+        }
+        *link = node->next;
+        free(node);
+    }
+}
+
+// Clear one source bit everywhere in the sibling list at link, freeing the nodes no longer needed
+static void trie_clear_source(struct trie_node **link, int source) {
+    while (*link != NULL) {
+        struct trie_node *node = *link;
+        node->sources &= ~((uint64_t)1 << source);
+        trie_clear_source(&node->child, source);
+        if (node->sources == 0 && node->child == NULL) {
+            *link = node->next;
+            free(node);
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+// Add a candidate to a completion list
+static void completions_add(struct completions *c, const char *item) {
+    if (c->count == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 32;
+        char **items = realloc(c->items, cap * sizeof(*items));
+        if (items == NULL) {
+            return;
+        }
+        c->items = items;
+        c->cap = cap;
+    }
+    char *copy = strdup(item);
+    if (copy != NULL) {
+        c->items[c->count++] = copy;
+    }
+}
+
+// Release a completion list
+static void completions_free(struct completions *c) {
+    for (int i = 0; i < c->count; i++) {
+        free(c->items[i]);
+    }
+    free(c->items);
+}
+
+// Collect every name below node; word holds the name so far
+static void trie_collect(const struct trie_node *node, char *word, size_t len, struct completions *out) {
+    if (node->sources != 0) {
+        word[len] = '\0';
+        completions_add(out, word);
+    }
+    if (len >= NAME_MAX) {
+        return;
+    }
+    for (const struct trie_node *n = node->child; n != NULL; n = n->next) {
+        word[len] = (char)n->ch;
+        trie_collect(n, word, len + 1, out);
+    }
+}
+
+// Collect the commands starting with prefix
+static void complete_command(const char *prefix, struct completions *out) {
+    const struct trie_node *node = &cmd_trie;
+    char word[NAME_MAX + 1];
+    size_t len = strlen(prefix);
+
+    if (len > NAME_MAX) {
+        return;
+    }
+    // Walk down the trie to the node for the prefix
+    for (const unsigned char *p = (const unsigned char *)prefix; *p != '\0' && node != NULL; p++) {
+        node = node->child;
+        while (node != NULL && node->ch < *p) {
+            node = node->next;
+        }
+        if (node != NULL && node->ch != *p) {
+            node = NULL;
+        }
+    }
+    if (node == NULL) {
+        return; // No command has this prefix
+    }
+    memcpy(word, prefix, len);
+    trie_collect(node, word, len, out);
+}
+
+// Re-check a single PATH entry and update its bit in the trie
+static void refresh_path_entry(int dirfd, const char *name, int source) {
+    struct stat st;
+    int exec = fstatat(dirfd, name, &st, 0) == 0 && S_ISREG(st.st_mode) && (st.st_mode & 0111);
+    trie_update(name, source, exec);
+}
+
+// getdents64 callback used while loading a PATH directory
+static void add_path_entry(int dirfd, const char *name, unsigned char type, void *ctx) {
+    if (name[0] == '.' || type == DT_DIR) {
+        return; // Skip hidden files and directories
+    }
+    refresh_path_entry(dirfd, name, *(int *)ctx);
+}
+
+// Mark a PATH directory to be loaded again from scratch by the idle steps
+static void mark_path_pending(int i) {
+    if (path_fd[i] != -1) {
+        close(path_fd[i]);
+        path_fd[i] = -1;
+    }
+    path_state[i] = PATH_PENDING;
+}
+
+// Start loading a PATH directory: forget its old entries, watch it for changes and open it
+static void start_path_load(int i) {
+    trie_clear_source(&cmd_trie.child, i);
+    path_retry[i] = 0;
+    if (inotify_fd != -1) {
+        path_watch[i] = inotify_add_watch(inotify_fd, path_dirs[i],
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | IN_ONLYDIR);
+        path_retry[i] = path_watch[i] == -1; // Missing directory, retry until it shows up
+    }
+    path_fd[i] = open(path_dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    path_state[i] = path_fd[i] != -1 ? PATH_LOADING : PATH_LOADED; // Missing PATH directories are ignored
+}
+
+// Do one bounded step of loading PATH: one getdents64 batch of one directory; returns 0 if nothing is left
+static int load_path_step(void) {
+    for (int i = 0; i < npath_dirs; i++) {
+        if (path_state[i] == PATH_PENDING) {
+            start_path_load(i);
+        }
+        if (path_state[i] == PATH_LOADING) {
+            if (!read_dirent_batch(path_fd[i], add_path_entry, &i)) {
+                close(path_fd[i]);
+                path_fd[i] = -1;
+                path_state[i] = PATH_LOADED;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Check whether every PATH directory has been loaded
+static int path_fully_loaded(void) {
+    for (int i = 0; i < npath_dirs; i++) {
+        if (path_state[i] != PATH_LOADED) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Apply pending inotify events to the trie without rescanning whole directories
+static void process_path_events(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t nread;
+
+    while ((nread = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + nread;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+
+            // The queue overflowed (e.g. during a long command), so changes were lost everywhere
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (int i = 0; i < npath_dirs; i++) {
+                    mark_path_pending(i);
+                }
+                continue;
+            }
+            // The watch is gone (directory removed or unmounted), so watch and load it again
+            if (ev->mask & IN_IGNORED) {
+                for (int i = 0; i < npath_dirs; i++) {
+                    if (path_watch[i] == ev->wd) {
+                        path_watch[i] = -1;
+                        mark_path_pending(i);
+                    }
+                }
+                continue;
+            }
+            if (ev->len == 0 || ev->name[0] == '.') {
+                continue; // Event on the directory itself, or on a hidden file
+            }
+            // Find the PATH directory this watch belongs to and re-check only the changed name
+            for (int i = 0; i < npath_dirs; i++) {
+                if (path_watch[i] == ev->wd && path_state[i] != PATH_PENDING) {
+                    int fd = open(path_dirs[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    if (fd != -1) {
+                        refresh_path_entry(fd, ev->name, i);
+                        close(fd);
+                    } else {
+                        trie_update(ev->name, i, 0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Set up command completion: builtins now, PATH directories later while the shell is idle
+static void completion_init(void) {
+    for (int i = 0; builtin_names[i] != NULL; i++) {
+        trie_update(builtin_names[i], BUILTIN_SOURCE, 1);
+    }
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    // Split PATH on ':' into the list of directories to load
+    const char *path = getenv("PATH");
+    if (path == NULL) {
+        return;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        return;
+    }
+    for (char *dir = strtok(copy, ":"); dir != NULL && npath_dirs < MAX_PATH_DIRS; dir = strtok(NULL, ":")) {
+        if (dir[0] != '/') {
+            continue; // Relative entries depend on the current directory, so they cannot be cached
+        }
+        path_dirs[npath_dirs] = strdup(dir);
+        if (path_dirs[npath_dirs] != NULL) {
+            path_watch[npath_dirs] = -1;
+            path_fd[npath_dirs] = -1;
+            path_state[npath_dirs] = PATH_PENDING;
+            npath_dirs++;
+        }
+    }
+    free(copy);
+}
+
+// Load PATH into the trie in bounded steps, stopping as soon as the user presses a key
+static void load_path_dirs(void) {
+    struct pollfd pfd = { .fd = 0, .events = POLLIN };
+    while (poll(&pfd, 1, 0) == 0 && load_path_step()) {
+    }
+}
+
+// getdents64 callback used while caching a directory for path completion
+static void add_cache_entry(int dirfd, const char *name, unsigned char type, void *ctx) {
+    struct dir_cache *dc = ctx;
+    struct stat st;
+
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return;
+    }
+    if (dc->count == dc->cap) {
+        int cap = dc->cap ? dc->cap * 2 : 64;
+        char **names = realloc(dc->names, cap * sizeof(*names));
+        if (names == NULL) {
+            return;
+        }
+        dc->names = names;
+        unsigned char *is_dir = realloc(dc->is_dir, cap);
+        if (is_dir == NULL) {
+            return;
+        }
+        dc->is_dir = is_dir;
+        dc->cap = cap;
+    }
+    char *copy = strdup(name);
+    if (copy == NULL) {
+        return;
+    }
+    // Symlinks and file systems without d_type need a stat to tell directories apart
+    int is_dir = type == DT_DIR;
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+        is_dir = fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+    dc->names[dc->count] = copy;
+    dc->is_dir[dc->count] = (unsigned char)is_dir;
+    dc->count++;
+}
+
+// Release a cached directory listing
+static void dir_cache_free(struct dir_cache *dc) {
+    for (int i = 0; i < dc->count; i++) {
+        free(dc->names[i]);
+    }
+    free(dc->names);
+    free(dc->is_dir);
+    free(dc->path);
+    free(dc);
+}
+
+// Return the cached listing of path, reading it again only if the directory changed
+static struct dir_cache *get_dir_cache(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    // Look the directory up and move it to the front, so the list stays in least recently used order
+    struct dir_cache **link = &dir_cache_head;
+    struct dir_cache *dc = NULL;
+    int cached = 0;
+    while (*link != NULL) {
+        if (strcmp((*link)->path, path) == 0) {
+            dc = *link;
+            *link = dc->next;
+            dc->next = dir_cache_head;
+            dir_cache_head = dc;
+            break;
+        }
+        cached++;
+        // Drop the least recently used listing once the cache is full
+        if (cached >= MAX_DIR_CACHE && (*link)->next == NULL) {
+            dir_cache_free(*link);
+            *link = NULL;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    // A cached listing is still valid if it is the same directory and it has not been modified
+    if (dc != NULL && dc->dev == st.st_dev && dc->ino == st.st_ino &&
+        dc->mtime.tv_sec == st.st_mtim.tv_sec && dc->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return dc;
+    }
+
+    if (dc == NULL) {
+        dc = calloc(1, sizeof(*dc));
+        if (dc == NULL) {
+            return NULL;
+        }
+        dc->path = strdup(path);
+        if (dc->path == NULL) {
+            free(dc);
+            return NULL;
+        }
+        dc->next = dir_cache_head;
+        dir_cache_head = dc;
+    }
+    // Drop the stale listing before reading the directory again
+    for (int i = 0; i < dc->count; i++) {
+        free(dc->names[i]);
+    }
+    dc->count = 0;
+    dc->dev = st.st_dev;
+    dc->ino = st.st_ino;
+    dc->mtime = st.st_mtim;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        for_each_dirent(fd, add_cache_entry, dc);
+        close(fd);
+    }
+    return dc;
+}
+
+// Collect the paths starting with word, directories get a trailing '/'
+static void complete_path(const char *word, struct completions *out) {
+    char dir[PATH_MAX];
+    char candidate[PATH_MAX];
+    const char *slash = strrchr(word, '/');
+    const char *base = word;
+    size_t dirlen = 0;
+
+    // Split the word into the directory to list and the prefix of the entry name
+    if (slash != NULL) {
+        dirlen = (size_t)(slash - word) + 1;
+        if (dirlen >= sizeof(dir)) {
+            return;
+        }
+        memcpy(dir, word, dirlen);
+        dir[dirlen] = '\0';
+        base = slash + 1;
+    } else {
+        strcpy(dir, ".");
+    }
+
+    struct dir_cache *dc = get_dir_cache(dir);
+    if (dc == NULL) {
+        return;
+    }
+    size_t baselen = strlen(base);
+    for (int i = 0; i < dc->count; i++) {
+        if (strncmp(dc->names[i], base, baselen) != 0) {
+            continue;
+        }
+        if (dc->names[i][0] == '.' && base[0] != '.') {
+            continue; // Hidden entries are only offered when asked for
+        }
+        if (snprintf(candidate, sizeof(candidate), "%.*s%s%s", (int)dirlen, word, dc->names[i],
+                     dc->is_dir[i] ? "/" : "") < (int)sizeof(candidate)) {
+            completions_add(out, candidate);
+        }
+    }
+}
+
+// Redraw the prompt and the line on a single terminal row, leaving the cursor at pos
+static void refresh_line(const char *prompt, const char *buf, size_t len, size_t pos) {
+    struct winsize ws;
+    size_t cols = 80;
+    if (ioctl(1, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        cols = ws.ws_col;
+    }
+
+    // A prompt wider than half the row (a deep cwd) is shortened to its end
+    size_t plen = strlen(prompt);
+    size_t pmax = cols / 2;
+    const char *shown = prompt;
+    int cut = 0;
+    if (plen > pmax && pmax > 3) {
+        shown = prompt + plen - (pmax - 3);
+        plen = pmax;
+        cut = 1;
+    }
+
+    // Scroll the line sideways so the cursor stays visible; the last column is kept free to avoid wrapping
+    size_t avail = cols > plen + 1 ? cols - plen - 1 : 1;
+    size_t start = pos > avail ? pos - avail : 0;
+    size_t shown_len = len - start < avail ? len - start : avail;
+
+    printf("\r%s%s", cut ? "..." : "", shown);
+    fwrite(buf + start, 1, shown_len, stdout);
+    printf("\033[K"); // Clear anything left over from a longer line
+    printf("\r");
+    if (plen + pos - start > 0) {
+        printf("\033[%zuC", plen + pos - start); // Move the cursor to pos
+    }
+    fflush(stdout);
+}
+
+// Read one more byte of an escape sequence, giving up if it does not arrive shortly
+static int read_escape_byte(unsigned char *c) {
+    struct pollfd pfd = { .fd = 0, .events = POLLIN };
+    return poll(&pfd, 1, ESC_TIMEOUT_MS) == 1 && read(0, c, 1) == 1;
+}
+
+// Insert text at the cursor if it fits
+static void insert_text(char *buf, size_t size, size_t *len, size_t *pos, const char *text, size_t n) {
+    if (*len + n >= size) {
+        return; // Line is full
+    }
+    memmove(buf + *pos + n, buf + *pos, *len - *pos);
+    memcpy(buf + *pos, text, n);
+    *len += n;
+    *pos += n;
+}
+
+// Complete the word under the cursor
+static void complete_line(const char *prompt, char *buf, size_t size, size_t *len, size_t *pos) {
+    struct completions c = { NULL, 0, 0 };
+    char word[MAX_LINE];
+
+    // The word runs from the last space before the cursor up to the cursor
+    size_t start = *pos;
+    while (start > 0 && buf[start - 1] != ' ' && buf[start - 1] != '\t') {
+        start--;
+    }
+    memcpy(word, buf + start, *pos - start);
+    word[*pos - start] = '\0';
+
+    // The first word is a command unless it looks like a path
+    size_t first = 0;
+    while (first < start && (buf[first] == ' ' || buf[first] == '\t')) {
+        first++;
+    }
+    if (first == start && strchr(word, '/') == NULL) {
+        complete_command(word, &c); // From whatever part of PATH is loaded so far
+    } else {
+        complete_path(word, &c);
+    }
+
+    if (c.count == 0) {
+        // A command may be missing only because PATH is still loading, so say so instead of "no match"
+        if (first == start && strchr(word, '/') == NULL && !path_fully_loaded()) {
+            printf("\n(still loading commands from PATH)\n");
+            refresh_line(prompt, buf, *len, *pos);
+        } else {
+            printf("\a"); // Nothing matches, ring the bell
+            fflush(stdout);
+        }
+        completions_free(&c);
+        return;
+    }
+
+    // Extend the word by the prefix shared by every candidate
+    size_t wordlen = strlen(word);
+    size_t common = strlen(c.items[0]);
+    for (int i = 1; i < c.count; i++) {
+        size_t j = 0;
+        while (j < common && c.items[i][j] == c.items[0][j]) {
+            j++;
+        }
+        common = j;
+    }
+    if (common > wordlen) {
+        insert_text(buf, size, len, pos, c.items[0] + wordlen, common - wordlen);
+    }
+
+    if (c.count == 1) {
+        // A unique match is finished off with a space, unless it is a directory to descend into
+        if (c.items[0][common - 1] != '/') {
+            insert_text(buf, size, len, pos, " ", 1);
+        }
+    } else if (common == wordlen) {
+        // Ambiguous and nothing to add, so list the candidates below the line without their directory part
+        const char *slash = strrchr(word, '/');
+        size_t skip = slash != NULL ? (size_t)(slash - word) + 1 : 0;
+        printf("\n");
+        for (int i = 0; i < c.count; i++) {
+            printf("%s  ", c.items[i] + skip);
+        }
+        printf("\n");
+    }
+    completions_free(&c);
+    refresh_line(prompt, buf, *len, *pos);
+}
+
+// Read one line from the terminal in raw mode; returns 0 on EOF
+static int read_line_interactive(const char *prompt, char *buf, size_t size) {
+    size_t len = 0;  // Length of the line
+    size_t pos = 0;  // Cursor position within the line
+    unsigned char c;
+
+    // Switch the terminal to raw mode so each key press is seen immediately
+    struct termios raw = orig_termios;
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(0, TCSADRAIN, &raw); // TCSADRAIN keeps type-ahead and pasted lines
+
+    // Catch up with PATH directories that changed while a command was running,
+    // and try again to watch the ones that were missing
+    if (inotify_fd != -1) {
+        process_path_events();
+    }
+    for (int i = 0; i < npath_dirs; i++) {
+        if (path_retry[i] && path_state[i] == PATH_LOADED) {
+            mark_path_pending(i);
+        }
+    }
+
+    refresh_line(prompt, buf, len, pos);
+
+    while (1) {
+        // Use the time the user spends thinking to load PATH, then wait for a key or a PATH change
+        load_path_dirs();
+        struct pollfd pfds[2] = {
+            { .fd = 0, .events = POLLIN },
+            { .fd = inotify_fd, .events = POLLIN },
+        };
+        if (poll(pfds, inotify_fd != -1 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (inotify_fd != -1 && (pfds[1].revents & POLLIN)) {
+            process_path_events();
+        }
+        if (!(pfds[0].revents & (POLLIN | POLLHUP))) {
+            continue;
+        }
+
+        if (read(0, &c, 1) != 1) {
+            break; // Terminal closed
+        }
+
+        // Enter: the line is complete
+        if (c == '\r' || c == '\n') {
+            printf("\n");
+            buf[len] = '\0';
+            tcsetattr(0, TCSADRAIN, &orig_termios);
+            return 1;
+        }
+        // Ctrl-D: EOF on an empty line, otherwise delete the character under the cursor
+        else if (c == 4) {
+            if (len == 0) {
+                break;
+            }
+            if (pos < len) {
+                memmove(buf + pos, buf + pos + 1, len - pos - 1);
+                len--;
+            }
+        }
+        // Ctrl-C: discard the line and start again
+        else if (c == 3) {
+            printf("^C\n");
+            len = pos = 0;
+        }
+        // Backspace
+        else if (c == 127 || c == 8) {
+            if (pos > 0) {
+                memmove(buf + pos - 1, buf + pos, len - pos);
+                pos--;
+                len--;
+            }
+        }
+        // Tab: complete the word under the cursor
+        else if (c == '\t') {
+            complete_line(prompt, buf, size, &len, &pos);
+            continue;
+        }
+        // Ctrl-A and Ctrl-E: start and end of line
+        else if (c == 1) {
+            pos = 0;
+        } else if (c == 5) {
+            pos = len;
+        }
+        // Ctrl-U: delete everything before the cursor
+        else if (c == 21) {
+            memmove(buf, buf + pos, len - pos);
+            len -= pos;
+            pos = 0;
+        }
+        // Ctrl-L: clear the screen
+        else if (c == 12) {
+            printf("\033[2J\033[H");
+        }
+        // Escape sequences for the arrow, Home, End and Delete keys
+        else if (c == 27) {
+            unsigned char seq[3];
+            if (!read_escape_byte(&seq[0]) || !read_escape_byte(&seq[1])) {
+                continue; // A lone Esc key, ignored
+            }
+            if (seq[0] == '[' || seq[0] == 'O') {
+                if (seq[1] == 'C' && pos < len) {
+                    pos++; // Right
+                } else if (seq[1] == 'D' && pos > 0) {
+                    pos--; // Left
+                } else if (seq[1] == 'H') {
+                    pos = 0; // Home
+                } else if (seq[1] == 'F') {
+                    pos = len; // End
+                } else if (seq[1] == '3' && read_escape_byte(&seq[2]) && seq[2] == '~' && pos < len) {
+                    memmove(buf + pos, buf + pos + 1, len - pos - 1); // Delete
+                    len--;
+                }
+            }
+        }
+        // Printable character
+        else if (c >= 32) {
+            char ch = (char)c;
+            insert_text(buf, size, &len, &pos, &ch, 1);
+        }
+
+        refresh_line(prompt, buf, len, pos);
+    }
+
+    // EOF or read error: restore the terminal and end the shell
+    printf("\n");
+    tcsetattr(0, TCSADRAIN, &orig_termios);
+    return 0;
 }
 
 // Commands
@@ -102,6 +1386,38 @@ static int process_line(char *line) {
     
     args[nargs] = NULL; // Indicate the end of the args array
 
+    // "on" prefix: placement options followed by the command to run with them
+    struct placement cmd_place;
+    int placed = 0;
+    if (strcmp(cmd, "on") == 0) {
+        memset(&cmd_place, 0, sizeof(cmd_place));
+        int first = 1; // Index of the first word after the options
+        int r;
+        while (args[first] != NULL && (r = parse_placement_option("on", args[first], &cmd_place)) != 0) {
+            if (r < 0) {
+                return 1; // Invalid option, the command is not run
+            }
+            first++;
+        }
+        if (args[first] == NULL) {
+            fprintf(stderr, "Usage: on [cpus=LIST] [nice=N] [mem=SIZE] [cpu=PCT] command [args]\n");
+            return 1;
+        }
+        // Shift the command and its arguments to the front of args[]
+        memmove(args, args + first, (nargs - first + 1) * sizeof(args[0]));
+        nargs -= first;
+        cmd = args[0];
+        placed = 1;
+
+        // Internal commands run inside the shell itself, so they cannot be placed
+        for (int i = 0; builtin_names[i] != NULL; i++) {
+            if (strcmp(cmd, builtin_names[i]) == 0) {
+                fprintf(stderr, "on: %s is an internal command, placement ignored\n", cmd);
+                placed = 0;
+            }
+        }
+    }
+
     // Redirection for internal commands
     int saved_stdout = -1; // Indicates no redirection
     if (outfile != NULL) { // If an output file is set
@@ -330,6 +1646,47 @@ static int process_line(char *line) {
         return 1; // End of command, continue shell loop
     }
 
+    // bgplace command
+    if (strcmp(cmd, "bgplace") == 0) {
+        // No arguments: show the default placement
+        if (args[1] == NULL) {
+            if (default_place_set) {
+                print_placement(&default_place);
+            } else {
+                printf("none\n");
+            }
+        }
+        // "off": background jobs inherit the shell's placement again
+        else if (strcmp(args[1], "off") == 0) {
+            default_place_set = 0;
+        }
+        // Otherwise replace the default placement with the given options
+        else {
+            struct placement pl;
+            memset(&pl, 0, sizeof(pl));
+            int valid = 1;
+            for (int i = 1; args[i] != NULL && valid; i++) {
+                int r = parse_placement_option("bgplace", args[i], &pl);
+                if (r == 0) {
+                    fprintf(stderr, "bgplace: unknown option: %s\n", args[i]);
+                }
+                valid = r > 0;
+            }
+            if (valid) {
+                default_place = pl;
+                default_place_set = 1;
+            }
+        }
+		// If the user used redirection
+        if (saved_stdout != -1) {
+			// Restore the original file descriptor
+            dup2(saved_stdout, 1);
+			// Close the backup
+            close(saved_stdout);
+        }
+        return 1; // End of command, continue shell loop
+    }
+
     // Restore stdout (if not already restored)
     if (saved_stdout != -1) {
 		// Restore the original file descriptor
@@ -340,12 +1697,52 @@ static int process_line(char *line) {
 
     // ---------- EXTERNAL COMMAND ----------
 
+	// Pick the placement: "on" options first, else the bgplace default for background jobs and batch mode
+    struct placement *place = NULL;
+    if (placed) {
+        place = &cmd_place;
+    } else if (default_place_set && (background || batch_mode)) {
+        place = &default_place;
+    }
+
+    const char *who = placed ? "on" : "bgplace"; // Name used in placement warnings
+
+	// Find a job slot for a placed background job, so it can be reported when it finishes
+    struct job *job = NULL;
+    if (place != NULL && background) {
+        for (int i = 0; i < MAX_JOBS && job == NULL; i++) {
+            if (jobs[i].pid == 0) {
+                job = &jobs[i];
+            }
+        }
+        if (job == NULL) {
+            fprintf(stderr, "%s: too many placed background jobs, no cgroup or usage report for this one%s\n", who,
+                    place->mem != 0 || place->cpu_pct != 0 ? ", memory/cpu limits not applied" : "");
+        }
+    }
+
+	// Create the job's cgroup, and a pipe for the child to say whether it managed to join it
+    char cgroup[PATH_MAX] = "";
+    int sync_fds[2] = { -1, -1 };
+    if (place != NULL && (job != NULL || !background)) {
+        prepare_job_cgroup(who, place, cgroup, sizeof(cgroup));
+        if (cgroup[0] != '\0' && pipe2(sync_fds, O_CLOEXEC) != 0) {
+            rmdir(cgroup);
+            cgroup[0] = '\0';
+        }
+    }
+
 	// Fork a child process to execute external commands
     pid_t pid = fork();
 
 	// If the process id is negative, it means the fork failed
     if (pid < 0) {
         perror("fork"); // Print an error message
+        if (cgroup[0] != '\0') {
+            close(sync_fds[0]);
+            close(sync_fds[1]);
+            rmdir(cgroup);
+        }
         return 1; // End of command, continue shell loop
     }
 	// If process id is 0, this is the child process
@@ -393,6 +1790,14 @@ static int process_line(char *line) {
         if (getenv("shell") != NULL) {
             setenv("parent", getenv("shell"), 1);
         }
+
+		// Apply CPU affinity, nice value and cgroup placement before running the command
+        if (place != NULL) {
+            if (sync_fds[0] != -1) {
+                close(sync_fds[0]);
+            }
+            apply_placement(who, place, cgroup, sync_fds[1]);
+        }
 		// Execute the external command using execvp, which replaces the current process image with a new program specified by cmd and args
         execvp(cmd, args);
 		// If execvp returns, it means there was an error executing the command, so print an error message
@@ -401,13 +1806,41 @@ static int process_line(char *line) {
     }
 	// This is the parent process
     else {
+		// Wait for the child to join its cgroup; if it could not, fall back to rusage for its usage
+        if (cgroup[0] != '\0') {
+            char joined = '0';
+            ssize_t n;
+            close(sync_fds[1]);
+            while ((n = read(sync_fds[0], &joined, 1)) < 0 && errno == EINTR) {
+            }
+            close(sync_fds[0]);
+            if (n != 1 || joined != '1') {
+				// No byte at all means the child exited before placement (e.g. a bad input file), which it reported itself
+                if (n == 1 && (place->mem != 0 || place->cpu_pct != 0)) {
+                    fprintf(stderr, "%s: could not join cgroup, memory/cpu limits not applied\n", who);
+                }
+                rmdir(cgroup);
+                cgroup[0] = '\0';
+            }
+        }
+
 		// If the background execution flag is not set
         if (!background) {
-            waitpid(pid, NULL, 0); // Wait for the child process
+            struct rusage ru;
+            wait4(pid, NULL, 0, &ru); // Wait for the child process
+			// Report the usage of a placed command
+            if (place != NULL) {
+                finish_job(pid, cgroup, &ru);
+            }
         }
 		// If the background execution flag is set
         else {
             printf("[background pid %d]\n", pid); // Print the background process ID to the user
+			// Track a placed background job until reap_zombies collects it
+            if (job != NULL) {
+                job->pid = pid;
+                strcpy(job->cgroup, cgroup);
+            }
         }
     }
 
@@ -432,6 +1865,7 @@ int main(int argc, char *argv[]) {
     FILE *in = stdin;
 	// If a batch file is provided as a command-line argument, open it for reading and set the input stream to the file
     if (argc == 2) {
+        batch_mode = 1; // The bgplace default applies to every external command in batch mode
         in = fopen(argv[1], "r"); // Open the batch file for reading
 		// If there was an error opening the batch file, print an error message and exit
         if (!in) {
@@ -448,6 +1882,14 @@ int main(int argc, char *argv[]) {
     char line[MAX_LINE];
 	// Buffer to hold the current working directory, used for displaying the prompt
     char cwd[PATH_MAX];
+	// Buffer to hold the prompt shown by the line editor
+    char prompt[PATH_MAX + 16];
+
+	// Use the line editor with tab completion when talking to a terminal
+    int editing = in == stdin && isatty(0) && isatty(1) && tcgetattr(0, &orig_termios) == 0;
+    if (editing) {
+        completion_init(); // PATH is loaded into the completion trie while waiting for input
+    }
 
 	// Main shell loop
     while (1) {
@@ -460,12 +1902,22 @@ int main(int argc, char *argv[]) {
 				perror("getcwd"); // If there was an error, print an error message
 				break; // Exit the shell loop
 			}
-            printf(">myshell:%s$ ", cwd); // Display the prompt with the current working directory
-            fflush(stdout); // Flush the output to ensure the prompt is displayed immediately
+            snprintf(prompt, sizeof(prompt), ">myshell:%s$ ", cwd); // Build the prompt with the current working directory
+        }
+		// Read a line through the line editor, which displays the prompt itself
+        if (editing) {
+            if (!read_line_interactive(prompt, line, sizeof(line)))
+                break; // EOF (Ctrl-D on an empty line), break out of the shell loop
         }
 		// Read a line of input from user or bactch file until EOF
-        if (!fgets(line, sizeof(line), in))
-			break; // If there was an error reading the line (e.g., EOF), break out of the shell loop
+        else {
+            if (in == stdin) {
+                printf("%s", prompt); // Display the prompt
+                fflush(stdout); // Flush the output to ensure the prompt is displayed immediately
+            }
+            if (!fgets(line, sizeof(line), in))
+                break; // If there was an error reading the line (e.g., EOF), break out of the shell loop
+        }
 
 		// Process the input line and execute the command
         if (process_line(line) == 0) // If 0, then it is the quit command
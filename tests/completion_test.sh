@@ -0,0 +1,63 @@
+#!/bin/sh
+# Tests for the line editor's tab completion
+# Drives the shell through a pseudo terminal with script(1) and checks how the line is redrawn.
+
+SHELL_BIN=$(realpath "${1:-./myshell}")
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+# Report a failed check
+fail() {
+    echo "FAIL: $1"
+    failures=$((failures + 1))
+}
+
+if ! command -v script > /dev/null 2>&1; then
+    echo "completion tests skipped: script(1) not found"
+    exit 0
+fi
+
+mkdir -p "$TMP/bin" "$TMP/work/subdir"
+touch "$TMP/work/apple.txt"
+
+# Send keys with pauses, so the shell can load PATH and see file changes in between (\025 is Ctrl-U)
+keys() {
+    sleep 1
+    printf 'ech\t'; sleep 0.3
+    printf '\025dir sub\t'; sleep 0.3
+    printf '\025cat ap\t'; sleep 0.3
+    touch "$TMP/work/apricot.txt"; sleep 0.3
+    printf '\025cat apr\t'; sleep 0.3
+    printf '#!/bin/sh\n' > "$TMP/bin/zzcomptest"; chmod +x "$TMP/bin/zzcomptest"; sleep 0.3
+    printf '\025zzcomp\t'; sleep 0.3
+    rm "$TMP/bin/zzcomptest"; sleep 0.3
+    printf '\025zzcomp\t'; sleep 0.3
+    printf '\025\004'; sleep 0.5
+}
+
+(cd "$TMP/work" && keys | PATH="$TMP/bin:$PATH" script -qfec "$SHELL_BIN" /dev/null > "$TMP/out" 2>&1)
+
+# Count how often the line was redrawn as the prompt followed by exactly the given text
+redrawn() {
+    grep -o -F "$(printf '$ %s\033[K' "$1")" "$TMP/out" | wc -l
+}
+
+# Internal commands complete with a trailing space
+[ "$(redrawn "echo ")" -ge 1 ] || fail "ech<Tab> did not complete to 'echo '"
+
+# Directories complete with a trailing '/'
+[ "$(redrawn "dir subdir/")" -ge 1 ] || fail "dir sub<Tab> did not complete to 'dir subdir/'"
+
+# Files complete, and a file created afterwards is seen despite the cached listing
+[ "$(redrawn "cat apple.txt ")" -ge 1 ] || fail "cat ap<Tab> did not complete to 'cat apple.txt '"
+[ "$(redrawn "cat apricot.txt ")" -ge 1 ] || fail "new file apricot.txt was not completed"
+
+# An executable added to a PATH directory is completed, and no longer once it is removed
+[ "$(redrawn "zzcomptest ")" -eq 1 ] || fail "zzcomptest not completed once (after creation only)"
+
+if [ "$failures" -ne 0 ]; then
+    echo "--- terminal output ---"; cat -v "$TMP/out"
+    exit 1
+fi
+echo "completion tests passed"
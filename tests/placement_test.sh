@@ -0,0 +1,70 @@
+#!/bin/sh
+# Tests for job placement (on / bgplace)
+# Runs as any user: without root or a writable cgroup the shell falls back to
+# rusage for job usage and skips memory/cpu limits, which is what is checked.
+
+SHELL_BIN=${1:-./myshell}
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+# Report a failed check
+fail() {
+    echo "FAIL: $1"
+    failures=$((failures + 1))
+}
+
+# Use the first CPU this process may run on, so the test works inside restricted cpusets
+cpu=$(grep Cpus_allowed_list /proc/self/status | sed 's/.*:[[:space:]]*//; s/[-,].*//')
+
+cat > "$TMP/batch" <<BATCH
+on cpus=$cpu grep Cpus_allowed_list /proc/self/status
+on nice=19 nice
+on mem=64M cpu=50 touch $TMP/limited
+on nice=-5 touch $TMP/raised
+on cpus=abc touch $TMP/invalid
+bgplace nice=19 mem=1G
+bgplace
+nice > $TMP/bg.txt &
+sleep 1
+bgplace off
+bgplace
+BATCH
+
+"$SHELL_BIN" "$TMP/batch" > "$TMP/out" 2> "$TMP/err"
+
+# Affinity is applied to the command
+grep -q "^Cpus_allowed_list:[[:space:]]*$cpu\$" "$TMP/out" || fail "cpus=$cpu not applied"
+
+# The nice value is applied to the command
+grep -qx "19" "$TMP/out" || fail "nice=19 not applied"
+
+# Limits that cannot be applied still run the command
+[ -f "$TMP/limited" ] || fail "command with mem/cpu limits did not run"
+
+# Raising priority without permission still runs the command
+[ -f "$TMP/raised" ] || fail "command with nice=-5 did not run"
+
+# Invalid options are rejected and the command is not run
+[ ! -f "$TMP/invalid" ] || fail "command with invalid cpu list ran"
+grep -q "invalid cpu list: abc" "$TMP/err" || fail "invalid cpu list not reported"
+
+# Usage is reported on stderr for every placed job, each value from the cgroup or from rusage
+[ "$(grep -c '^\[job [0-9]* done: cpu .* ms (\(cgroup\|rusage\)), peak mem .* MiB (\(cgroup\|rusage\))\]$' "$TMP/err")" -ge 5 ] ||
+    fail "job usage not reported"
+! grep -q '^\[job ' "$TMP/out" || fail "job usage reported on stdout"
+
+# Only the one "on mem=" command may warn as on; jobs placed by the bgplace default warn as bgplace
+[ "$(grep -c '^on: .*memory' "$TMP/err")" -le 1 ] || fail "bgplace warnings named after on"
+
+# bgplace shows, applies and clears the default placement for background jobs
+grep -qx "nice=19 mem=1G" "$TMP/out" || fail "bgplace does not show the default placement"
+[ "$(cat "$TMP/bg.txt" 2>/dev/null)" = "19" ] || fail "bgplace default not applied to background job"
+grep -qx "none" "$TMP/out" || fail "bgplace off did not clear the default placement"
+
+if [ "$failures" -ne 0 ]; then
+    echo "--- stdout ---"; cat "$TMP/out"
+    echo "--- stderr ---"; cat "$TMP/err"
+    exit 1
+fi
+echo "placement tests passed"